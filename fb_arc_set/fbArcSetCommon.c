@@ -0,0 +1,185 @@
+#include "fbArcSetCommon.h"
+
+static int perfBucket(uint64_t ns);
+static uint64_t perfBucketValue(int bucket);
+static void perfDumpText(FILE *, const char *, uint64_t, perfHistogram *[], int);
+static void perfDumpJson(FILE *, const char *, uint64_t, perfHistogram *[], int);
+
+/**
+ * @brief Reads the monotonic clock, which is shared by all processes on the system
+ * 
+ * @return uint64_t The current time in nanoseconds
+ */
+uint64_t perfNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+/**
+ * @brief Records a measured duration in the histogram
+ * 
+ * @param histogram The histogram to record into
+ * @param ns The measured duration in nanoseconds
+ */
+void perfRecord(perfHistogram *histogram, uint64_t ns) {
+    if (histogram->count == 0 || ns < histogram->minNs)
+        histogram->minNs = ns;
+    if (ns > histogram->maxNs)
+        histogram->maxNs = ns;
+
+    histogram->count++;
+    histogram->totalNs += ns;
+    histogram->buckets[perfBucket(ns)]++;
+}
+
+/**
+ * @brief Estimates a percentile of the recorded durations
+ * 
+ * @param histogram The histogram to evaluate
+ * @param percentile The percentile between 0 and 100
+ * @return uint64_t The upper bound of the bucket which contains the percentile, in nanoseconds
+ */
+uint64_t perfPercentile(const perfHistogram *histogram, double percentile) {
+    if (histogram->count == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t) (percentile / 100.0 * histogram->count + 0.5);
+    if (rank == 0)
+        rank = 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < PERF_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= rank) {
+            uint64_t upper = perfBucketValue(i + 1) - 1;
+            return upper < histogram->maxNs ? upper : histogram->maxNs;
+        }
+    }
+    return histogram->maxNs;
+}
+
+/**
+ * @brief Writes a summary of all histograms. If the environment variable FB_PERF_JSON names
+ * a directory, the summary is written as JSON to <directory>/<program>-<pid>.json, otherwise
+ * as text to stderr.
+ * 
+ * @param programName The name of the program
+ * @param wallNs The total runtime which was measured, used for the share of each timer
+ * @param histograms The histograms to write
+ * @param count The amount of histograms
+ */
+void perfDump(const char *programName, uint64_t wallNs, perfHistogram *histograms[], int count) {
+    const char *directory = getenv("FB_PERF_JSON");
+    if (directory == NULL || *directory == '\0') {
+        perfDumpText(stderr, programName, wallNs, histograms, count);
+        return;
+    }
+
+    const char *baseName = strrchr(programName, '/');
+    baseName = (baseName == NULL) ? programName : baseName + 1;
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s-%ld.json", directory, baseName, (long) getpid());
+
+    FILE *output = fopen(path, "w");
+    if (output == NULL) {
+        fprintf(stderr, "[%s] Could not open perf summary %s: %s\n", programName, path, strerror(errno));
+        perfDumpText(stderr, programName, wallNs, histograms, count);
+        return;
+    }
+
+    perfDumpJson(output, programName, wallNs, histograms, count);
+
+    if (fclose(output) == EOF) {
+        fprintf(stderr, "[%s] Could not close perf summary %s: %s\n", programName, path, strerror(errno));
+    }
+}
+
+/**
+ * @brief Maps a duration onto its histogram bucket, the first sub buckets are exact,
+ * after that every power of two is split into PERF_SUB_BUCKETS buckets
+ * 
+ * @param ns The duration in nanoseconds
+ * @return int The index of the bucket
+ */
+static int perfBucket(uint64_t ns) {
+    if (ns < PERF_SUB_BUCKETS)
+        return (int) ns;
+
+    int magnitude = 63 - __builtin_clzll(ns);
+    int shift = magnitude - PERF_SUB_BUCKET_BITS;
+    int subBucket = (int) ((ns >> shift) & (PERF_SUB_BUCKETS - 1));
+
+    return (shift + 1) * PERF_SUB_BUCKETS + subBucket;
+}
+
+/**
+ * @brief Returns the lowest duration which falls into the given bucket
+ * 
+ * @param bucket The index of the bucket
+ * @return uint64_t The lowest duration of the bucket in nanoseconds
+ */
+static uint64_t perfBucketValue(int bucket) {
+    if (bucket < PERF_SUB_BUCKETS)
+        return bucket;
+    if (bucket >= PERF_BUCKETS)
+        return UINT64_MAX;
+
+    int shift = bucket / PERF_SUB_BUCKETS - 1;
+    uint64_t subBucket = bucket % PERF_SUB_BUCKETS;
+
+    return (PERF_SUB_BUCKETS | subBucket) << shift;
+}
+
+/**
+ * @brief Writes the summary as text, one line per histogram
+ * 
+ * @param output The file to write to
+ * @param programName The name of the program
+ * @param wallNs The total runtime which was measured
+ * @param histograms The histograms to write
+ * @param count The amount of histograms
+ */
+static void perfDumpText(FILE *output, const char *programName, uint64_t wallNs, perfHistogram *histograms[], int count) {
+    fprintf(output, "[%s] perf summary over %.3f s\n", programName, wallNs / 1e9);
+
+    for (int i = 0; i < count; i++) {
+        perfHistogram *h = histograms[i];
+        fprintf(output, "[%s]   %-14s count %10llu  total %9.3f s (%5.1f%%)  mean %9llu ns"
+                "  p50 %9llu ns  p99 %9llu ns  max %9llu ns\n",
+                programName, h->name, (unsigned long long) h->count, h->totalNs / 1e9,
+                wallNs == 0 ? 0.0 : 100.0 * h->totalNs / wallNs,
+                (unsigned long long) (h->count == 0 ? 0 : h->totalNs / h->count),
+                (unsigned long long) perfPercentile(h, 50), (unsigned long long) perfPercentile(h, 99),
+                (unsigned long long) h->maxNs);
+    }
+}
+
+/**
+ * @brief Writes the summary as a single JSON object
+ * 
+ * @param output The file to write to
+ * @param programName The name of the program
+ * @param wallNs The total runtime which was measured
+ * @param histograms The histograms to write
+ * @param count The amount of histograms
+ */
+static void perfDumpJson(FILE *output, const char *programName, uint64_t wallNs, perfHistogram *histograms[], int count) {
+    fprintf(output, "{\n  \"program\": \"%s\",\n  \"pid\": %ld,\n  \"wall_ns\": %llu,\n  \"timers\": [",
+            programName, (long) getpid(), (unsigned long long) wallNs);
+
+    for (int i = 0; i < count; i++) {
+        perfHistogram *h = histograms[i];
+        fprintf(output, "%s\n    {\"name\": \"%s\", \"count\": %llu, \"total_ns\": %llu, \"min_ns\": %llu,"
+                " \"mean_ns\": %llu, \"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu,"
+                " \"max_ns\": %llu}",
+                i == 0 ? "" : ",", h->name, (unsigned long long) h->count, (unsigned long long) h->totalNs,
+                (unsigned long long) h->minNs, (unsigned long long) (h->count == 0 ? 0 : h->totalNs / h->count),
+                (unsigned long long) perfPercentile(h, 50), (unsigned long long) perfPercentile(h, 90),
+                (unsigned long long) perfPercentile(h, 99), (unsigned long long) perfPercentile(h, 99.9),
+                (unsigned long long) h->maxNs);
+    }
+
+    fprintf(output, "\n  ]\n}\n");
+}
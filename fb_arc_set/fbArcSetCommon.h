@@ -31,6 +31,9 @@ typedef struct edge {
 typedef struct solution {
     edge fbArcSet[8];
     int edgeCount;
+#ifdef FB_INSTRUMENT
+    uint64_t postedNs; // perfNow() when the generator posted the solution
+#endif
 } solution;
 
 typedef struct sharedData {
@@ -41,4 +44,35 @@ typedef struct sharedData {
 
 } sharedData;
 
+/*
+ * Hot path instrumentation, enabled by compiling with -DFB_INSTRUMENT (make INSTRUMENT=1).
+ * Every timer records into a log-linear histogram with 16 sub buckets per power of two,
+ * so percentiles are accurate to about 6%.
+ */
+#define PERF_SUB_BUCKET_BITS 4
+#define PERF_SUB_BUCKETS (1 << PERF_SUB_BUCKET_BITS)
+#define PERF_BUCKETS ((64 - PERF_SUB_BUCKET_BITS + 1) * PERF_SUB_BUCKETS)
+
+typedef struct perfHistogram {
+    const char *name;
+    uint64_t count;
+    uint64_t totalNs;
+    uint64_t minNs;
+    uint64_t maxNs;
+    uint64_t buckets[PERF_BUCKETS];
+} perfHistogram;
+
+uint64_t perfNow(void);
+void perfRecord(perfHistogram *histogram, uint64_t ns);
+uint64_t perfPercentile(const perfHistogram *histogram, double percentile);
+void perfDump(const char *programName, uint64_t wallNs, perfHistogram *histograms[], int count);
+
+#ifdef FB_INSTRUMENT
+#define PERF_BEGIN(timer) uint64_t timer = perfNow()
+#define PERF_END(histogram, timer) perfRecord(&(histogram), perfNow() - (timer))
+#else
+#define PERF_BEGIN(timer)
+#define PERF_END(histogram, timer)
+#endif
+
 #endif
\ No newline at end of file
@@ -20,6 +20,14 @@ sem_t *semFree;
 sem_t *semUsed;
 sem_t *semBlocked;
 
+#ifdef FB_INSTRUMENT
+static perfHistogram perfShuffle = {.name = "shuffle"};
+static perfHistogram perfFindFbArcSet = {.name = "findFbArcSet"};
+static perfHistogram perfWaitBlocked = {.name = "wait blocked"};
+static perfHistogram perfWaitFree = {.name = "wait free"};
+static perfHistogram perfShmCopy = {.name = "shm copy"};
+#endif
+
 /**
  * @brief The main entrypoint of the program
  * 
@@ -56,9 +64,15 @@ int main(int argc, char *argv[]) {
 
     edge fbArcSet[edgeCount];
     int fbCount, bestFbCount = 100;
+    PERF_BEGIN(perfRun);
     while (data->state == 1) {
+        PERF_BEGIN(perfTimer);
         shuffle(nodes, nodeCount);
+        PERF_END(perfShuffle, perfTimer);
+
+        PERF_BEGIN(perfFindTimer);
         fbCount = findFbArcSet(nodeCount, nodes, edgeCount, edges, fbArcSet);
+        PERF_END(perfFindFbArcSet, perfFindTimer);
 
         //Check if our current solution is trash
         if (fbCount >= bestFbCount)
@@ -73,18 +87,22 @@ int main(int argc, char *argv[]) {
         }
         printf("\n");
 
+        PERF_BEGIN(perfBlockedTimer);
         if (sem_wait(semBlocked) == -1) {
             writeError("Error while 'blocked' semaphore is waiting", false);
             teardown();
             exit(EXIT_FAILURE);
         }
 
+        PERF_END(perfWaitBlocked, perfBlockedTimer);
+
         //Check if we should shut down
         if (data->state != 1) {
             sem_post(semUsed);
             break;
         }
 
+        PERF_BEGIN(perfFreeTimer);
         if (sem_wait(semFree) == -1) {
             writeError("Error while 'free' semaphore is waiting", false);
 
@@ -98,11 +116,18 @@ int main(int argc, char *argv[]) {
             }
         }
 
+        PERF_END(perfWaitFree, perfFreeTimer);
+
+        PERF_BEGIN(perfCopyTimer);
         data->buffer[data->writerPosition].edgeCount = fbCount;
         for (int i=0; i<fbCount; i++) {
             data->buffer[data->writerPosition].fbArcSet[i].node1 = fbArcSet[i].node1;
             data->buffer[data->writerPosition].fbArcSet[i].node2 = fbArcSet[i].node2;
         }
+        PERF_END(perfShmCopy, perfCopyTimer);
+#ifdef FB_INSTRUMENT
+        data->buffer[data->writerPosition].postedNs = perfNow();
+#endif
 
         data->writerPosition = (data->writerPosition+1) % BUFFER_SIZE;
 
@@ -110,6 +135,11 @@ int main(int argc, char *argv[]) {
         sem_post(semBlocked);
     }
 
+#ifdef FB_INSTRUMENT
+    perfHistogram *histograms[] = {&perfShuffle, &perfFindFbArcSet, &perfWaitBlocked, &perfWaitFree, &perfShmCopy};
+    perfDump(programName, perfNow() - perfRun, histograms, sizeof(histograms) / sizeof(histograms[0]));
+#endif
+
     teardown();
 
     return EXIT_SUCCESS;
@@ -15,6 +15,11 @@ sem_t *semFree;
 sem_t *semUsed;
 sem_t *semBlocked;
 
+#ifdef FB_INSTRUMENT
+static perfHistogram perfWaitUsed = {.name = "wait used"};
+static perfHistogram perfPostToConsume = {.name = "post->consume"};
+#endif
+
 /**
  * @brief The main entrypoint of the program
  * 
@@ -48,9 +53,14 @@ int main(int argc, char *argv[]) {
     data->writerPosition = 0;
     data->state = 1;
 
+    PERF_BEGIN(perfRun);
+#ifdef FB_INSTRUMENT
+    uint64_t perfLastConsume = perfRun;
+#endif
     while (data->state == 1) {
         //Todo: check for state again??
 
+        PERF_BEGIN(perfTimer);
         if (sem_wait(semUsed) == -1)
         {
             if (errno != EINTR)
@@ -66,7 +76,14 @@ int main(int argc, char *argv[]) {
             break;
         }
 
+        //Only successful waits are recorded, the interrupted one is idle time until shutdown
+        PERF_END(perfWaitUsed, perfTimer);
+
         solution sol = data->buffer[readerPosition];
+#ifdef FB_INSTRUMENT
+        perfLastConsume = perfNow();
+        perfRecord(&perfPostToConsume, perfLastConsume - sol.postedNs);
+#endif
         readerPosition = (readerPosition + 1) % BUFFER_SIZE;
 
         if (sol.edgeCount == 0) {
@@ -89,6 +106,12 @@ int main(int argc, char *argv[]) {
         sem_post(semFree);
     }
 
+#ifdef FB_INSTRUMENT
+    perfHistogram *histograms[] = {&perfWaitUsed, &perfPostToConsume};
+    //The run window ends with the last consumed solution, so the wait before shutdown is not counted
+    perfDump(programName, perfLastConsume - perfRun, histograms, sizeof(histograms) / sizeof(histograms[0]));
+#endif
+
     teardown();
 }
 
@@ -0,0 +1,153 @@
+#!/bin/sh
+# ispalindrom benchmark
+# Author: Patrick Zdarsky (12123697)
+#
+# Generates synthetic corpora and measures the throughput of ispalindrom for
+# every flag combination and input path. The results are written as JSON.
+#
+# Environment:
+#   BIN         binary to benchmark (default ./ispalindrom)
+#   CORPUS_DIR  where the generated corpora are stored (default bench-corpora)
+#   OUTPUT      JSON result file (default bench.json)
+#   LINES       lines per short line corpus, the long line corpus uses LINES/50 (default 200000)
+#   REPEAT      runs per measurement, the fastest one is reported (default 3)
+#   INPUTS      input paths to measure, any of "file stdin" (default both)
+#   FLAGS       flag combinations to measure, "none" for no flags and "_" between
+#               multiple flags (default "none -s -i -s_-i"), each is run with and without -o
+
+set -e
+
+BIN=${BIN:-./ispalindrom}
+CORPUS_DIR=${CORPUS_DIR:-bench-corpora}
+OUTPUT=${OUTPUT:-bench.json}
+LINES=${LINES:-200000}
+REPEAT=${REPEAT:-3}
+INPUTS=${INPUTS:-"file stdin"}
+
+CORPORA="short long palindromes mismatch mixed"
+FLAGS=${FLAGS:-"none -s -i -s_-i"}
+
+# generate <name> <lines> <awk program>
+# The awk program prints one line per iteration, rnd(n) and word(n) are available.
+generate() {
+    file="$CORPUS_DIR/$1.txt"
+    if [ -f "$file" ] && [ "$(wc -l < "$file")" -eq "$2" ]; then
+        return
+    fi
+    awk -v lines="$2" '
+        function rnd(n) { return int(rand() * n) }
+        function word(n,   s, i) {
+            s = ""
+            for (i = 0; i < n; i++)
+                s = s substr("abcdefghijklmnopqrstuvwxyz", rnd(26) + 1, 1)
+            return s
+        }
+        function reverse(s,   r, i) {
+            r = ""
+            for (i = length(s); i > 0; i--)
+                r = r substr(s, i, 1)
+            return r
+        }
+        BEGIN { srand(12123697); for (line = 0; line < lines; line++) { '"$3"' } }
+    ' > "$file"
+}
+
+mkdir -p "$CORPUS_DIR"
+
+# Short random lines, almost none of them are palindromes
+generate short "$LINES" 'print word(1 + rnd(16))'
+# Long lines of 4 KiB
+generate long $((LINES / 50)) 'half = word(2048); print (rnd(2) ? half reverse(half) : half word(2048))'
+# Mostly palindromes, the whole line has to be compared
+generate palindromes "$LINES" 'half = word(16 + rnd(112)); print (rnd(10) ? half reverse(half) : half word(16))'
+# Long lines which already differ in the first and last character
+generate mismatch "$LINES" 'print "a" word(254) "b"'
+# Palindromes with mixed case and whitespace, only found with -s -i
+generate mixed "$LINES" '
+    half = word(8 + rnd(56)); s = half reverse(half); out = ""
+    for (i = 1; i <= length(s); i++) {
+        c = substr(s, i, 1)
+        out = out (rnd(2) ? toupper(c) : c) (rnd(6) ? "" : " ")
+    }
+    print out'
+
+now() {
+    date +%s%N
+}
+
+# measure <corpus> <flags> <input> <output>
+# Prints the fastest of REPEAT runs in nanoseconds, fails if the binary does not exit successfully
+measure() {
+    outputArgs=""
+    if [ "$4" = file ]; then
+        outputArgs="-o $CORPUS_DIR/out.txt"
+    fi
+
+    best=""
+    run=0
+    while [ $run -lt "$REPEAT" ]; do
+        status=0
+        start=$(now)
+        if [ "$3" = file ]; then
+            "$BIN" $2 $outputArgs "$CORPUS_DIR/$1.txt" > /dev/null || status=$?
+        else
+            "$BIN" $2 $outputArgs < "$CORPUS_DIR/$1.txt" > /dev/null || status=$?
+        fi
+        end=$(now)
+
+        if [ $status -ne 0 ]; then
+            echo "$BIN $2 $outputArgs ($1, $3) exited with status $status" >&2
+            return 1
+        fi
+
+        elapsed=$((end - start))
+        if [ -z "$best" ] || [ "$elapsed" -lt "$best" ]; then
+            best=$elapsed
+        fi
+        run=$((run + 1))
+    done
+    echo "$best"
+}
+
+{
+    printf '{\n'
+    printf '  "timestamp": "%s",\n' "$(date -u +%Y-%m-%dT%H:%M:%SZ)"
+    printf '  "commit": "%s",\n' "$(git rev-parse --short HEAD 2>/dev/null || echo unknown)"
+    printf '  "repeat": %d,\n' "$REPEAT"
+    printf '  "results": ['
+} > "$OUTPUT"
+
+separator=""
+for corpus in $CORPORA; do
+    lines=$(wc -l < "$CORPUS_DIR/$corpus.txt")
+    bytes=$(wc -c < "$CORPUS_DIR/$corpus.txt")
+
+    for flags in $FLAGS; do
+        args=$(echo "$flags" | sed -e 's/none//' -e 's/_/ /g')
+
+        for input in $INPUTS; do
+            for output in stdout file; do
+                if ! ns=$(measure "$corpus" "$args" "$input" "$output"); then
+                    rm -f "$OUTPUT"
+                    echo "Benchmark aborted, no results written" >&2
+                    exit 1
+                fi
+                [ "$ns" -gt 0 ] || ns=1
+
+                printf '%s\n    {"corpus": "%s", "flags": "%s", "output": "%s", "input": "%s", "lines": %d, "bytes": %d, "seconds": %s, "lines_per_sec": %s, "mb_per_sec": %s}' \
+                    "$separator" "$corpus" "$args" "$output" "$input" "$lines" "$bytes" \
+                    "$(awk -v ns="$ns" 'BEGIN { printf "%.6f", ns / 1e9 }')" \
+                    "$(awk -v ns="$ns" -v n="$lines" 'BEGIN { printf "%.0f", n / (ns / 1e9) }')" \
+                    "$(awk -v ns="$ns" -v n="$bytes" 'BEGIN { printf "%.2f", n / 1048576 / (ns / 1e9) }')" \
+                    >> "$OUTPUT"
+                separator=","
+
+                awk -v c="$corpus" -v f="${args:--}" -v i="$input" -v o="$output" -v ns="$ns" -v n="$lines" -v b="$bytes" \
+                    'BEGIN { printf "%-12s %-6s %-6s %-7s %12.0f lines/s %9.2f MB/s\n", c, f, i, o, n / (ns / 1e9), b / 1048576 / (ns / 1e9) }' >&2
+            done
+        done
+    done
+done
+
+printf '\n  ]\n}\n' >> "$OUTPUT"
+echo "Results written to $OUTPUT" >&2
@@ -1,7 +1,10 @@
 /**
  * @file main.c
  * @author Patrick ZDARSKY (12123697)
- * @brief Program to check if strings are palindromes. Can read the values from stdin or input files and writes the reult to stdout or an output file
+ * @brief Program to check if strings are palindromes. Can read the values from stdin or input files and writes the reult to stdout or an output file.
+ * With -l the longest palindromic substring and with -c the number of palindromic substrings of each line are reported instead.
+ * With -u lines are compared by UTF-8 code points instead of bytes, pure ASCII lines still take the byte path.
+ * With -m lines longer than the given amount of bytes are spilled to a temporary file and compared from both ends there.
  * @version 0.1
  * @date 2022-11-01
  * 
@@ -16,6 +19,135 @@
 #include <getopt.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+/**
+ * @brief Growable scratch memory which is reused for every processed line,
+ * so the per-line work does not have to allocate
+ */
+typedef struct scratchArena {
+    char *memory;
+    size_t capacity;
+    size_t used;
+} scratchArena;
+
+/**
+ * @brief Options which control how each line is normalized and analysed
+ */
+typedef struct options {
+    bool caseInsensitive;
+    bool ignoreWhitespace;
+    bool longestSubstring;
+    bool countSubstrings;
+    bool utf8;
+    unsigned whitespaceClasses;
+    bool whitespaceBytes[256]; // whitespaceClasses as a lookup table for the byte path
+    size_t maxLineLength; // 0 => every line is held in memory
+} options;
+
+/**
+ * @brief Result of the palindromic substring analysis of a single line
+ */
+typedef struct palindromStats {
+    size_t longestStart;
+    size_t longestLength;
+    size_t count;
+} palindromStats;
+
+#define WHITESPACE_SPACE   (1u << 0) // ' '
+#define WHITESPACE_TAB     (1u << 1) // '\t'
+#define WHITESPACE_VERTICAL (1u << 2) // '\n', '\v', '\f', '\r'
+#define WHITESPACE_UNICODE (1u << 3) // Unicode space separators (only in UTF-8 mode)
+
+#define SPILL_BLOCK_SIZE (64 * 1024)
+#define SPILL_RESET_SIZE (64 * 1024 * 1024) // spilled lines are appended until the file reaches this size
+#define UTF8_MAX_SEQUENCE 4
+
+#define HIGH_BITS UINT64_C(0x8080808080808080)
+#define INVALID_BYTE_BASE 0xDC00 // Invalid UTF-8 bytes are mapped onto lone surrogates, which never decode from valid input
+
+#define ARENA_ALIGNMENT (sizeof(size_t))
+#define ARENA_ALIGN(size) (((size) + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1))
+
+/**
+ * @brief Block wise read access to a spilled line, used to walk it from either end
+ */
+typedef struct spillCursor {
+    int fd;
+    off_t base; // offset of the line in the spill file
+    off_t blockStart;
+    size_t blockLength;
+    int error; // errno of the first failed read, 0 if all reads succeeded
+    unsigned char block[SPILL_BLOCK_SIZE];
+} spillCursor;
+
+/**
+ * @brief Reads lines in blocks with a bounded amount of memory per line. Spilled lines are first
+ * collected in spillBuffer, only lines which do not fit into it are written to the spill file.
+ * The spill file is created for the first such line and reused for all later ones.
+ */
+typedef struct boundedReader {
+    int fd;
+    size_t position;
+    size_t filled;
+    bool eof;
+    FILE *spill;
+    off_t spillBase; // offset of the current spilled line in the spill file
+    off_t spillEnd; // end of the used part of the spill file
+    off_t spillWritten; // bytes of the current spilled line which were written to the spill file
+    size_t spillBuffered; // bytes of the current spilled line which are still in spillBuffer
+    char block[SPILL_BLOCK_SIZE];
+    char spillBuffer[SPILL_BLOCK_SIZE];
+} boundedReader;
+
+#define READ_EOF (-1)
+#define READ_ERROR (-2)
+
+static char *programName;
+
+/**
+ * @brief Makes sure the arena can hold at least the given amount of bytes and discards
+ * all previous allocations. The backing memory only ever grows.
+ * 
+ * @param arena The arena to reset
+ * @param required The amount of bytes which will be allocated from the arena
+ * @return true If the arena is large enough
+ * @return false If the arena could not be grown
+ */
+static bool arenaReset(scratchArena *arena, size_t required) {
+    arena->used = 0;
+    if (required <= arena->capacity)
+        return true;
+
+    size_t capacity = arena->capacity == 0 ? 4096 : arena->capacity;
+    while (capacity < required) {
+        capacity *= 2;
+    }
+
+    char *memory = realloc(arena->memory, capacity);
+    if (memory == NULL)
+        return false;
+
+    arena->memory = memory;
+    arena->capacity = capacity;
+    return true;
+}
+
+/**
+ * @brief Allocates memory from the arena. The arena must have been reset with a size
+ * which covers all allocations (including alignment) of the current line.
+ * 
+ * @param arena The arena to allocate from
+ * @param size The amount of bytes to allocate
+ * @return void* The allocated memory
+ */
+static void *arenaAlloc(scratchArena *arena, size_t size) {
+    void *memory = arena->memory + arena->used;
+    arena->used += ARENA_ALIGN(size);
+    return memory;
+}
 
 /**
  * @brief Checks whether a given string is a palindrom
@@ -35,8 +167,8 @@ static bool isPalindrom(char* value, bool caseInsensitive) {
         char c2 = value[length-1-i];
 
         if (caseInsensitive) {
-            c1 = toupper(c1);
-            c2 = toupper(c2);
+            c1 = toupper((unsigned char) c1);
+            c2 = toupper((unsigned char) c2);
         }
 
         if (c1 != c2)
@@ -45,6 +177,305 @@ static bool isPalindrom(char* value, bool caseInsensitive) {
     return true;
 }
 
+/**
+ * @brief Checks whether a sequence of code points is a palindrom
+ * 
+ * @param value The code points to be checked, already case folded if needed
+ * @param length The amount of code points
+ * @return true If the sequence is a palindrom
+ * @return false If the sequence is not a palindrom
+ */
+static bool isCodePointPalindrom(const uint32_t *value, size_t length) {
+    if (length == 0)
+        return false;
+
+    for (size_t i = 0; i < length/2; i++) {
+        if (value[i] != value[length-1-i])
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Checks whether the given bytes are pure ASCII. The high bits are tested
+ * eight bytes at a time, so long ASCII lines cost only a few instructions per word
+ * 
+ * @param value The bytes to check
+ * @param length The amount of bytes
+ * @return true If no byte has the high bit set
+ * @return false If the value contains non ASCII bytes
+ */
+static bool isAscii(const char *value, size_t length) {
+    size_t i = 0;
+
+    for (; i + 4 * sizeof(uint64_t) <= length; i += 4 * sizeof(uint64_t)) {
+        uint64_t words[4];
+        memcpy(words, value + i, sizeof(words));
+        if ((words[0] | words[1] | words[2] | words[3]) & HIGH_BITS)
+            return false;
+    }
+    for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, value + i, sizeof(word));
+        if (word & HIGH_BITS)
+            return false;
+    }
+    for (; i < length; i++) {
+        if ((unsigned char) value[i] & 0x80)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Decodes a single UTF-8 sequence. Invalid, overlong and surrogate sequences
+ * are decoded as a single invalid byte, so that they still compare byte-wise.
+ * 
+ * @param value The bytes to decode from
+ * @param length The amount of bytes which are available
+ * @param consumed Receives the amount of bytes which were decoded
+ * @return uint32_t The decoded code point
+ */
+static uint32_t decodeUtf8(const unsigned char *value, size_t length, size_t *consumed) {
+    unsigned char lead = value[0];
+    size_t needed;
+    uint32_t codePoint, minimum;
+
+    *consumed = 1;
+    if (lead < 0x80)
+        return lead;
+
+    if ((lead & 0xE0) == 0xC0) {
+        needed = 1; codePoint = lead & 0x1F; minimum = 0x80;
+    } else if ((lead & 0xF0) == 0xE0) {
+        needed = 2; codePoint = lead & 0x0F; minimum = 0x800;
+    } else if ((lead & 0xF8) == 0xF0) {
+        needed = 3; codePoint = lead & 0x07; minimum = 0x10000;
+    } else {
+        return INVALID_BYTE_BASE | lead;
+    }
+
+    if (needed >= length)
+        return INVALID_BYTE_BASE | lead;
+
+    for (size_t i = 1; i <= needed; i++) {
+        if ((value[i] & 0xC0) != 0x80)
+            return INVALID_BYTE_BASE | lead;
+        codePoint = (codePoint << 6) | (value[i] & 0x3F);
+    }
+
+    if (codePoint < minimum || codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF))
+        return INVALID_BYTE_BASE | lead;
+
+    *consumed = needed + 1;
+    return codePoint;
+}
+
+/**
+ * @brief Simple (one to one) case folding for Latin, Greek, Cyrillic and fullwidth Latin letters
+ * 
+ * @param codePoint The code point to fold
+ * @return uint32_t The lower case variant of the code point, or the code point itself
+ */
+static uint32_t foldCase(uint32_t codePoint) {
+    if (codePoint < 0x80)
+        return (uint32_t) tolower((int) codePoint);
+
+    if (codePoint == 0xB5)
+        return 0x3BC; // MICRO SIGN => GREEK SMALL LETTER MU
+    if (codePoint >= 0xC0 && codePoint <= 0xDE && codePoint != 0xD7)
+        return codePoint + 0x20;
+
+    //Latin Extended-A alternates between upper and lower case
+    if (codePoint >= 0x100 && codePoint <= 0x137 && codePoint != 0x130)
+        return codePoint | 1;
+    if ((codePoint >= 0x139 && codePoint <= 0x148) || (codePoint >= 0x179 && codePoint <= 0x17E))
+        return (codePoint & 1) ? codePoint + 1 : codePoint;
+    if (codePoint >= 0x14A && codePoint <= 0x177)
+        return codePoint | 1;
+    if (codePoint == 0x178)
+        return 0xFF;
+    if (codePoint == 0x17F)
+        return 's';
+
+    //Greek
+    if (codePoint == 0x386)
+        return 0x3AC;
+    if (codePoint >= 0x388 && codePoint <= 0x38A)
+        return codePoint + 0x25;
+    if (codePoint == 0x38C)
+        return 0x3CC;
+    if (codePoint == 0x38E || codePoint == 0x38F)
+        return codePoint + 0x3F;
+    if (codePoint >= 0x391 && codePoint <= 0x3AB && codePoint != 0x3A2)
+        return codePoint + 0x20;
+    if (codePoint == 0x3C2)
+        return 0x3C3; // final sigma
+
+    //Cyrillic
+    if (codePoint >= 0x400 && codePoint <= 0x40F)
+        return codePoint + 0x50;
+    if (codePoint >= 0x410 && codePoint <= 0x42F)
+        return codePoint + 0x20;
+    if ((codePoint >= 0x460 && codePoint <= 0x481) || (codePoint >= 0x48A && codePoint <= 0x4BF))
+        return codePoint | 1;
+
+    //Fullwidth Latin
+    if (codePoint >= 0xFF21 && codePoint <= 0xFF3A)
+        return codePoint + 0x20;
+
+    return codePoint;
+}
+
+/**
+ * @brief Checks whether the code point belongs to one of the given whitespace classes
+ * 
+ * @param codePoint The code point to check
+ * @param classes The WHITESPACE_* classes which count as whitespace
+ * @return true If the code point is whitespace
+ * @return false If the code point is not whitespace
+ */
+static bool isWhitespace(uint32_t codePoint, unsigned classes) {
+    switch (codePoint) {
+        case ' ':
+            return classes & WHITESPACE_SPACE;
+        case '\t':
+            return classes & WHITESPACE_TAB;
+        case '\n': case '\v': case '\f': case '\r':
+            return classes & WHITESPACE_VERTICAL;
+        case 0x85: case 0xA0: case 0x1680: case 0x2028: case 0x2029:
+        case 0x202F: case 0x205F: case 0x3000:
+            return classes & WHITESPACE_UNICODE;
+        default:
+            return (classes & WHITESPACE_UNICODE) && codePoint >= 0x2000 && codePoint <= 0x200A;
+    }
+}
+
+/**
+ * @brief Parses the whitespace classes given with -w
+ * 
+ * @param value The classes, any combination of 's' (space), 't' (tab), 'v' (line breaks) and 'u' (Unicode spaces)
+ * @param classes Receives the parsed WHITESPACE_* classes
+ * @return true If all classes are known
+ * @return false If an unknown class was given
+ */
+static bool parseWhitespaceClasses(const char *value, unsigned *classes) {
+    *classes = 0;
+    for (; *value != '\0'; value++) {
+        switch (*value) {
+            case 's': *classes |= WHITESPACE_SPACE;
+                break;
+            case 't': *classes |= WHITESPACE_TAB;
+                break;
+            case 'v': *classes |= WHITESPACE_VERTICAL;
+                break;
+            case 'u': *classes |= WHITESPACE_UNICODE;
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Decodes a UTF-8 value into code points and applies the whitespace and case normalization
+ * 
+ * @param value The UTF-8 value to decode
+ * @param length The length of the value in bytes
+ * @param opts The options which control the normalization
+ * @param normalized Receives the value without the removed whitespace, must have room for length+1 bytes
+ * @param codePoints Receives the normalized code points, must have room for length elements
+ * @param offsets If not NULL, receives the byte offset of every code point in normalized,
+ *                followed by the length of normalized. Must have room for length+1 elements
+ * @return size_t The amount of decoded code points
+ */
+static size_t decodeValue(const char *value, size_t length, options *opts, char *normalized,
+                          uint32_t *codePoints, size_t *offsets) {
+    const unsigned char *bytes = (const unsigned char *) value;
+    size_t count = 0, written = 0, consumed;
+
+    for (size_t i = 0; i < length; i += consumed) {
+        uint32_t codePoint = decodeUtf8(bytes + i, length - i, &consumed);
+
+        if (opts->ignoreWhitespace && isWhitespace(codePoint, opts->whitespaceClasses))
+            continue;
+
+        if (offsets != NULL)
+            offsets[count] = written;
+        codePoints[count++] = opts->caseInsensitive ? foldCase(codePoint) : codePoint;
+
+        memcpy(normalized + written, value + i, consumed);
+        written += consumed;
+    }
+
+    normalized[written] = '\0';
+    if (offsets != NULL)
+        offsets[count] = written;
+    return count;
+}
+
+/**
+ * @brief Computes the palindromic substrings of the given string with Manacher's algorithm in linear time
+ * 
+ * @param value The code points to analyse, must already be normalized (case folded, whitespace removed)
+ * @param length The amount of code points
+ * @param odd Scratch array with room for length elements, receives the radii of the odd length palindromes
+ * @param even Scratch array with room for length elements, receives the radii of the even length palindromes
+ * @param stats Receives the longest palindromic substring and the number of palindromic substrings
+ */
+static void findPalindromicSubstrings(const uint32_t *value, ptrdiff_t length, ptrdiff_t odd[], ptrdiff_t even[], palindromStats *stats) {
+    stats->longestStart = 0;
+    stats->longestLength = 0;
+    stats->count = 0;
+
+    //Odd length palindromes, odd[i] is the number of palindromes centered at i
+    for (ptrdiff_t i = 0, left = 0, right = -1; i < length; i++) {
+        ptrdiff_t k = (i > right) ? 1 : odd[left + right - i];
+        if (i <= right && k > right - i + 1)
+            k = right - i + 1;
+
+        while (i - k >= 0 && i + k < length && value[i - k] == value[i + k]) {
+            k++;
+        }
+        odd[i] = k--;
+
+        if (i + k > right) {
+            left = i - k;
+            right = i + k;
+        }
+
+        stats->count += odd[i];
+        if ((size_t) (2 * odd[i] - 1) > stats->longestLength) {
+            stats->longestLength = 2 * odd[i] - 1;
+            stats->longestStart = i - odd[i] + 1;
+        }
+    }
+
+    //Even length palindromes, even[i] is the number of palindromes centered between i-1 and i
+    for (ptrdiff_t i = 0, left = 0, right = -1; i < length; i++) {
+        ptrdiff_t k = (i > right) ? 0 : even[left + right - i + 1];
+        if (i <= right && k > right - i + 1)
+            k = right - i + 1;
+
+        while (i - k - 1 >= 0 && i + k < length && value[i - k - 1] == value[i + k]) {
+            k++;
+        }
+        even[i] = k--;
+
+        if (i + k > right) {
+            left = i - k - 1;
+            right = i + k;
+        }
+
+        stats->count += even[i];
+        if ((size_t) (2 * even[i]) > stats->longestLength) {
+            stats->longestLength = 2 * even[i];
+            stats->longestStart = i - even[i];
+        }
+    }
+}
+
 /**
  * @brief Removes trailing newline characters from the given string
  * 
@@ -53,8 +484,8 @@ static bool isPalindrom(char* value, bool caseInsensitive) {
 static void removeStringTrailingNewline(char *value) {
   if (value == NULL)
     return;
-  int length = strlen(value);
-  if (value[length-1] == '\n')
+  size_t length = strlen(value);
+  if (length > 0 && value[length-1] == '\n')
     value[length-1]  = '\0';
 }
 
@@ -62,12 +493,13 @@ static void removeStringTrailingNewline(char *value) {
  * @brief Removes whitespace caracters from the given string
  * 
  * @param value The string to remove whitespace characters from, it must be editable
+ * @param whitespace Lookup table of the bytes which should be removed, '\0' must not be marked
  */
-static void removeWhitespace(char* value) {
+static void removeWhitespace(char* value, const bool whitespace[256]) {
     char* d = value;
     do {
         // Advance untill we passed all the whitespaces
-        while (*d == ' ') {
+        while (whitespace[(unsigned char) *d]) {
             ++d;
         }
     // Write the non whitespace character in our original string and 
@@ -76,77 +508,759 @@ static void removeWhitespace(char* value) {
 }
 
 /**
- * @brief Checks a given value if it is a palindrome and writes the result to the output file
+ * @brief Analyses the palindromic substrings of the normalized value and writes the result to the output file
+ * 
+ * @param value The original value
+ * @param normalized The value after whitespace removal, used for the output of the longest substring
+ * @param key The normalized code points which are compared
+ * @param length The amount of code points
+ * @param offsets The byte offsets of the code points in normalized, or NULL if every code point is a single byte
+ * @param opts The options which control the analysis
+ * @param arena The scratch arena, which must have room for both radius arrays
+ * @param output The output file to where to write the result
+ */
+static void analyseValue(char* value, char* normalized, uint32_t *key, size_t length, size_t *offsets,
+                         options *opts, scratchArena *arena, FILE *output) {
+    ptrdiff_t *odd = arenaAlloc(arena, length * sizeof(ptrdiff_t));
+    ptrdiff_t *even = arenaAlloc(arena, length * sizeof(ptrdiff_t));
+
+    palindromStats stats;
+    findPalindromicSubstrings(key, length, odd, even, &stats);
+
+    if (opts->longestSubstring) {
+        if (stats.longestLength == 0) {
+            fprintf(output, "%s contains no palindrom\n", value);
+        } else {
+            size_t start = stats.longestStart, bytes = stats.longestLength;
+            if (offsets != NULL) {
+                start = offsets[stats.longestStart];
+                bytes = offsets[stats.longestStart + stats.longestLength] - start;
+            }
+            fprintf(output, "%s has the longest palindrom %.*s with %zu characters\n", value,
+                    (int) bytes, normalized + start, stats.longestLength);
+        }
+    }
+    if (opts->countSubstrings) {
+        fprintf(output, "%s contains %zu palindromic substrings\n", value, stats.count);
+    }
+}
+
+/**
+ * @brief Checks a given value if it is a palindrome and writes the result to the output file.
+ * In UTF-8 mode non ASCII values are decoded and compared by code points, all other values
+ * are compared byte-wise.
  * 
  * @param value The value to check
- * @param caseInsensitive If true, check case insensitive
- * @param ignoreWhitespace  If true, ignores whitespace characters
+ * @param opts The options which control the check
+ * @param arena The scratch arena used for the normalized copy of the value
  * @param output The output file to where to write the result
+ * @return true If the value was processed
+ * @return false If there was not enough memory for the value
+ */
+static bool processValue(char* value, options *opts, scratchArena *arena, FILE *output) {
+    size_t length = strlen(value);
+    bool analyse = opts->longestSubstring || opts->countSubstrings;
+    bool decode = opts->utf8 && !isAscii(value, length);
+
+    size_t required = ARENA_ALIGN(length + 1);
+    if (decode || analyse)
+        required += ARENA_ALIGN(length * sizeof(uint32_t));
+    if (decode && analyse)
+        required += ARENA_ALIGN((length + 1) * sizeof(size_t));
+    if (analyse)
+        required += 2 * ARENA_ALIGN(length * sizeof(ptrdiff_t));
+
+    if (!arenaReset(arena, required)) {
+        fprintf(stderr, "%s: could not allocate memory for a line of %zu characters\n", programName, length);
+        return false;
+    }
+
+    char *normalized = arenaAlloc(arena, length + 1);
+    uint32_t *key = NULL;
+    size_t *offsets = NULL;
+    size_t keyLength;
+    bool palindrom;
+
+    if (decode) {
+        key = arenaAlloc(arena, length * sizeof(uint32_t));
+        if (analyse)
+            offsets = arenaAlloc(arena, (length + 1) * sizeof(size_t));
+
+        keyLength = decodeValue(value, length, opts, normalized, key, offsets);
+    } else {
+        memcpy(normalized, value, length + 1);
+
+        if (opts->ignoreWhitespace) {
+            removeWhitespace(normalized, opts->whitespaceBytes);
+        }
+
+        if (!analyse) {
+            palindrom = isPalindrom(normalized, opts->caseInsensitive);
+            fprintf(output, palindrom ? "%s is a palindrom\n" : "%s is not a palindrom\n", value);
+            return true;
+        }
+
+        keyLength = strlen(normalized);
+        key = arenaAlloc(arena, keyLength * sizeof(uint32_t));
+        for (size_t i = 0; i < keyLength; i++) {
+            unsigned char c = normalized[i];
+            key[i] = opts->caseInsensitive ? (uint32_t) toupper(c) : c;
+        }
+    }
+
+    if (analyse) {
+        analyseValue(value, normalized, key, keyLength, offsets, opts, arena, output);
+        return true;
+    }
+
+    palindrom = isCodePointPalindrom(key, keyLength);
+    fprintf(output, palindrom ? "%s is a palindrom\n" : "%s is not a palindrom\n", value);
+    return true;
+}
+
+/**
+ * @brief Returns the byte at the given offset of a spilled line, reading a new block if needed
+ * 
+ * @param cursor The cursor to read with
+ * @param offset The offset of the byte in the spilled line
+ * @param length The length of the spilled line
+ * @param backwards If true the block is placed before the offset, as the cursor is moving towards the start
+ * @return int The byte, or -1 if it could not be read, the reason is stored in the error of the cursor
+ */
+static int spillByte(spillCursor *cursor, off_t offset, off_t length, bool backwards) {
+    if (offset < cursor->blockStart || offset >= cursor->blockStart + (off_t) cursor->blockLength) {
+        off_t start = offset;
+        if (backwards) {
+            //Keep the bytes of a whole UTF-8 sequence after the offset in the block as well
+            start = offset + UTF8_MAX_SEQUENCE - SPILL_BLOCK_SIZE;
+            if (start < 0)
+                start = 0;
+        }
+
+        size_t toRead = SPILL_BLOCK_SIZE;
+        if (length - start < (off_t) toRead)
+            toRead = length - start;
+
+        ssize_t read = pread(cursor->fd, cursor->block, toRead, cursor->base + start);
+        if (read <= 0 || offset >= start + read) {
+            cursor->error = (read == -1) ? errno : EIO;
+            return -1;
+        }
+
+        cursor->blockStart = start;
+        cursor->blockLength = read;
+    }
+    return cursor->block[offset - cursor->blockStart];
+}
+
+/**
+ * @brief Decodes the character starting at the given offset of a spilled line
+ * 
+ * @param cursor The cursor to read with
+ * @param offset The offset of the first byte of the character
+ * @param length The length of the spilled line
+ * @param opts The options, which decide if the line is decoded as UTF-8
+ * @param backwards If the cursor is moving towards the start
+ * @param consumed Receives the amount of bytes of the character
+ * @return uint32_t The character. If it could not be read, the error of the cursor is set
+ */
+static uint32_t spillCharAt(spillCursor *cursor, off_t offset, off_t length, options *opts, bool backwards, size_t *consumed) {
+    unsigned char bytes[UTF8_MAX_SEQUENCE];
+    size_t available = 0;
+
+    //Fast path for single bytes which are already in the block
+    if (offset >= cursor->blockStart && offset < cursor->blockStart + (off_t) cursor->blockLength &&
+        (!opts->utf8 || cursor->block[offset - cursor->blockStart] < 0x80)) {
+        *consumed = 1;
+        return cursor->block[offset - cursor->blockStart];
+    }
+
+    while (available < (opts->utf8 ? UTF8_MAX_SEQUENCE : 1) && offset + (off_t) available < length) {
+        int byte = spillByte(cursor, offset + available, length, backwards);
+        if (byte == -1)
+            break;
+        bytes[available++] = byte;
+    }
+
+    if (available == 0) {
+        *consumed = 1;
+        return INVALID_BYTE_BASE;
+    }
+    if (!opts->utf8) {
+        *consumed = 1;
+        return bytes[0];
+    }
+    return decodeUtf8(bytes, available, consumed);
+}
+
+/**
+ * @brief Decodes the character which ends right before the given offset of a spilled line
+ * 
+ * @param cursor The cursor to read with
+ * @param end The offset after the last byte of the character
+ * @param length The length of the spilled line
+ * @param opts The options, which decide if the line is decoded as UTF-8
+ * @param consumed Receives the amount of bytes of the character
+ * @return uint32_t The character
  */
-static void processValue(char* value, bool caseInsensitive, bool ignoreWhitespace, FILE *output) {
-    char *toCheck = strdup(value);
+static uint32_t spillCharBefore(spillCursor *cursor, off_t end, off_t length, options *opts, size_t *consumed) {
+    //A single byte, which is all there is in byte mode and for ASCII in UTF-8 mode
+    uint32_t last = spillCharAt(cursor, end - 1, end, opts, true, consumed);
+    if (!opts->utf8 || last < 0x80)
+        return last;
+
+    //Find the start of a sequence which decodes to exactly the bytes before end, the longest one
+    //first, as a single continuation byte always decodes on its own as an invalid byte
+    for (off_t start = end - UTF8_MAX_SEQUENCE; start < end - 1; start++) {
+        if (start < 0)
+            continue;
 
-    if (ignoreWhitespace) {
-        removeWhitespace(toCheck);
+        uint32_t codePoint = spillCharAt(cursor, start, end, opts, true, consumed);
+        if ((off_t) *consumed == end - start)
+            return codePoint;
     }
 
-    bool palindrom = isPalindrom(toCheck, caseInsensitive);
+    *consumed = 1;
+    return last;
+}
+
+/**
+ * @brief Normalizes a character of a spilled line the same way the in memory paths do
+ * 
+ * @param character The character to normalize
+ * @param opts The options which control the normalization
+ * @return uint32_t The case folded character
+ */
+static uint32_t spillFold(uint32_t character, options *opts) {
+    if (!opts->caseInsensitive)
+        return character;
+    if (opts->utf8)
+        return foldCase(character);
+    return toupper((int) character);
+}
 
-    if (palindrom) {
-        fprintf(output, "%s is a palindrom\n", value);
+/**
+ * @brief Checks whether a spilled line is a palindrom by comparing from both ends of the file,
+ * only two blocks of the line are held in memory at any time
+ * 
+ * @param front The cursor which walks from the start of the line
+ * @param back The cursor which walks from the end of the line, may be the same as front
+ * @param length The length of the line in bytes
+ * @param opts The options which control the check
+ * @param error Receives the errno if the line could not be read, otherwise 0
+ * @return true If the line is a palindrom
+ * @return false If the line is not a palindrom or could not be read
+ */
+static bool isSpilledPalindrom(spillCursor *front, spillCursor *back, off_t length, options *opts, int *error) {
+    unsigned classes = opts->ignoreWhitespace ? opts->whitespaceClasses : 0;
+    if (!opts->utf8)
+        classes &= ~WHITESPACE_UNICODE;
+
+    off_t start = 0, end = length;
+    bool empty = true;
+    *error = 0;
+    size_t startConsumed, endConsumed;
+
+    while (true) {
+        uint32_t first = 0, last = 0;
+
+        while (start < end) {
+            first = spillCharAt(front, start, length, opts, false, &startConsumed);
+            if (front->error != 0) {
+                *error = front->error;
+                return false;
+            }
+            if (classes == 0 || !isWhitespace(first, classes))
+                break;
+            start += startConsumed;
+        }
+        if (start >= end)
+            break;
+
+        while (end > start) {
+            last = spillCharBefore(back, end, length, opts, &endConsumed);
+            if (back->error != 0) {
+                *error = back->error;
+                return false;
+            }
+            if (classes == 0 || !isWhitespace(last, classes))
+                break;
+            end -= endConsumed;
+        }
+
+        empty = false;
+        if (spillFold(first, opts) != spillFold(last, opts))
+            return false;
+
+        start += startConsumed;
+        end -= endConsumed;
+    }
+
+    return !empty;
+}
+
+/**
+ * @brief Copies a spilled line to the output file. Short lines are still in the block of the cursor
+ * 
+ * @param cursor The cursor of the spilled line, its block is reused for copying
+ * @param length The length of the line in bytes
+ * @param output The output file
+ * @return true If the line was copied
+ * @return false If the spilled line could not be read or the output could not be written
+ */
+static bool writeSpill(spillCursor *cursor, off_t length, FILE *output) {
+    if (cursor->blockStart == 0 && (off_t) cursor->blockLength == length) {
+        if (fwrite(cursor->block, 1, cursor->blockLength, output) != cursor->blockLength) {
+            fprintf(stderr, "%s: could not write the output: %s\n", programName, strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    cursor->blockLength = 0;
+    for (off_t offset = 0; offset < length; ) {
+        size_t toRead = SPILL_BLOCK_SIZE;
+        if (length - offset < (off_t) toRead)
+            toRead = length - offset;
+
+        ssize_t read = pread(cursor->fd, cursor->block, toRead, cursor->base + offset);
+        if (read <= 0) {
+            fprintf(stderr, "%s: could not read the temporary file: %s\n", programName,
+                    strerror(read == -1 ? errno : EIO));
+            return false;
+        }
+        if (fwrite(cursor->block, 1, read, output) != (size_t) read) {
+            fprintf(stderr, "%s: could not write the output: %s\n", programName, strerror(errno));
+            return false;
+        }
+        offset += read;
+    }
+    return true;
+}
+
+/**
+ * @brief Checks a line which was spilled and writes the result to the output file
+ * 
+ * @param reader The reader which spilled the line, either to its spill buffer or to its spill file
+ * @param length The length of the line in bytes
+ * @param opts The options which control the check
+ * @param output The output file to where to write the result
+ * @return true If the line was processed or skipped on purpose
+ * @return false If the spilled line could not be read back
+ */
+static bool processSpilledValue(boundedReader *reader, off_t length, options *opts, FILE *output) {
+    static spillCursor front, back;
+
+    if (opts->longestSubstring || opts->countSubstrings) {
+        fprintf(stderr, "%s: skipping a line of %lld bytes, -l and -c need the whole line in memory\n",
+                programName, (long long) length);
+        return true;
+    }
+
+    front.error = back.error = 0;
+    front.blockLength = back.blockLength = 0;
+    if (reader->spillWritten == 0) {
+        //The whole line is still in the spill buffer
+        front.fd = -1;
+        front.blockStart = 0;
+        front.blockLength = length;
+        memcpy(front.block, reader->spillBuffer, length);
     } else {
-        fprintf(output, "%s is not a palindrom\n", value);
+        front.fd = back.fd = fileno(reader->spill);
+        front.base = back.base = reader->spillBase;
+    }
+
+    //A line which fits into a single block is read only once
+    spillCursor *end = (length <= SPILL_BLOCK_SIZE) ? &front : &back;
+    int error;
+    bool palindrom = isSpilledPalindrom(&front, end, length, opts, &error);
+    if (error != 0) {
+        fprintf(stderr, "%s: could not read the temporary file: %s\n", programName, strerror(error));
+        return false;
+    }
+
+    if (!writeSpill(&front, length, output))
+        return false;
+    fprintf(output, palindrom ? " is a palindrom\n" : " is not a palindrom\n");
+    return true;
+}
+
+/**
+ * @brief Writes all given bytes to the spill file
+ * 
+ * @param reader The reader, which owns the spill file
+ * @param data The bytes to write
+ * @param count The amount of bytes
+ * @return true If all bytes were written
+ * @return false If writing failed
+ */
+static bool writeSpillFile(boundedReader *reader, const char *data, size_t count) {
+    if (reader->spill == NULL && (reader->spill = tmpfile()) == NULL) {
+        fprintf(stderr, "%s: could not create a temporary file: %s\n", programName, strerror(errno));
+        return false;
     }
 
-    free(toCheck);
+    while (count > 0) {
+        ssize_t written = pwrite(fileno(reader->spill), data, count, reader->spillBase + reader->spillWritten);
+        if (written == -1) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "%s: could not write the temporary file: %s\n", programName, strerror(errno));
+            return false;
+        }
+        data += written;
+        count -= written;
+        reader->spillWritten += written;
+    }
+    return true;
 }
 
 /**
- * @brief Checks a given file for palindromes and writes the result in the given output file
+ * @brief Appends bytes to the current spilled line, they are collected in the spill buffer
+ * and written to the spill file when it is full
+ * 
+ * @param reader The reader, which owns the spill buffer and file
+ * @param data The bytes to append
+ * @param count The amount of bytes
+ * @return true If the bytes were appended
+ * @return false If the spill file could not be written
+ */
+static bool appendSpill(boundedReader *reader, const char *data, size_t count) {
+    if (reader->spillBuffered + count > SPILL_BLOCK_SIZE) {
+        if (!writeSpillFile(reader, reader->spillBuffer, reader->spillBuffered))
+            return false;
+        reader->spillBuffered = 0;
+
+        if (count > SPILL_BLOCK_SIZE)
+            return writeSpillFile(reader, data, count);
+    }
+
+    memcpy(reader->spillBuffer + reader->spillBuffered, data, count);
+    reader->spillBuffered += count;
+    return true;
+}
+
+/**
+ * @brief Starts spilling a new line. Lines are appended to the spill file, which is only
+ * truncated once it grew beyond SPILL_RESET_SIZE.
+ * 
+ * @param reader The reader, which owns the spill file
+ * @return true If the spill file is ready
+ * @return false If the spill file could not be truncated
+ */
+static bool startSpill(boundedReader *reader) {
+    if (reader->spillEnd > SPILL_RESET_SIZE) {
+        if (ftruncate(fileno(reader->spill), 0) == -1) {
+            fprintf(stderr, "%s: could not truncate the temporary file: %s\n", programName, strerror(errno));
+            return false;
+        }
+        reader->spillEnd = 0;
+    }
+
+    reader->spillBase = reader->spillEnd;
+    reader->spillWritten = 0;
+    reader->spillBuffered = 0;
+    return true;
+}
+
+/**
+ * @brief Appends a part of the current line to the line buffer. When the buffer already holds
+ * maxLength bytes, they are spilled first.
+ * 
+ * @param reader The reader, which owns the spill buffer and file
+ * @param data The bytes to append
+ * @param count The amount of bytes to append
+ * @param line The line buffer, grown as needed up to maxLength+1 bytes
+ * @param capacity The capacity of the line buffer
+ * @param length The amount of bytes in the line buffer
+ * @param maxLength The maximum amount of bytes which are held in memory
+ * @param spilled The amount of bytes of the current line which were already spilled
+ * @return true If the bytes were appended
+ * @return false If the spill file could not be written or there was not enough memory
+ */
+static bool appendLine(boundedReader *reader, const char *data, size_t count, char **line, size_t *capacity,
+                       size_t *length, size_t maxLength, size_t *spilled) {
+    while (count > 0) {
+        if (*length == maxLength) {
+            if (*spilled == 0 && !startSpill(reader))
+                return false;
+
+            if (!appendSpill(reader, *line, *length))
+                return false;
+            *spilled += *length;
+            *length = 0;
+        }
+
+        size_t part = maxLength - *length;
+        if (part > count)
+            part = count;
+
+        //Keep room for the terminating '\0'
+        if (*length + part + 1 > *capacity) {
+            size_t grown = *capacity < 64 ? 128 : *capacity;
+            while (grown < *length + part + 1) {
+                grown *= 2;
+            }
+            if (grown > maxLength + 1)
+                grown = maxLength + 1;
+
+            char *resized = realloc(*line, grown);
+            if (resized == NULL) {
+                fprintf(stderr, "%s: could not allocate memory for a line\n", programName);
+                return false;
+            }
+            *line = resized;
+            *capacity = grown;
+        }
+
+        memcpy(*line + *length, data, part);
+        *length += part;
+        data += part;
+        count -= part;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads the next line, but holds at most maxLength bytes of it (without the newline) in memory.
+ * Longer lines are spilled instead, see appendSpill. Like on the getline path, only
+ * the bytes before the first '\0' of a line are used.
+ * 
+ * @param reader The reader to read from
+ * @param line The line buffer, grown as needed up to maxLength+1 bytes. Receives the line without
+ *             the newline if it was held in memory
+ * @param capacity The capacity of the line buffer
+ * @param maxLength The maximum amount of bytes which are held in memory
+ * @param spilled Set to true if the line was spilled, see processSpilledValue
+ * @return ssize_t The length of the line without the newline, READ_EOF if there are no more lines
+ *                 or READ_ERROR if the line could not be read
+ */
+static ssize_t readBoundedLine(boundedReader *reader, char **line, size_t *capacity, size_t maxLength, bool *spilled) {
+    size_t length = 0, spilledLength = 0;
+    bool anyRead = false, truncated = false;
+
+    while (true) {
+        if (reader->position == reader->filled) {
+            if (reader->eof)
+                break;
+
+            ssize_t received = read(reader->fd, reader->block, sizeof(reader->block));
+            if (received == -1) {
+                if (errno == EINTR)
+                    continue;
+                fprintf(stderr, "%s: error while reading input: %s\n", programName, strerror(errno));
+                return READ_ERROR;
+            }
+            if (received == 0) {
+                reader->eof = true;
+                break;
+            }
+            reader->position = 0;
+            reader->filled = received;
+        }
+
+        char *start = reader->block + reader->position;
+        size_t available = reader->filled - reader->position;
+        char *newline = memchr(start, '\n', available);
+        size_t count = (newline != NULL) ? (size_t) (newline - start) : available;
+
+        reader->position += count + (newline != NULL);
+        anyRead = true;
+
+        if (!truncated) {
+            char *nul = memchr(start, '\0', count);
+            if (nul != NULL) {
+                count = nul - start;
+                truncated = true;
+            }
+            if (!appendLine(reader, start, count, line, capacity, &length, maxLength, &spilledLength))
+                return READ_ERROR;
+        }
+
+        if (newline != NULL)
+            break;
+    }
+
+    if (!anyRead)
+        return READ_EOF;
+
+    *spilled = spilledLength > 0;
+    if (*spilled) {
+        if (!appendSpill(reader, *line, length))
+            return READ_ERROR;
+
+        //Lines which do not fit into the spill buffer are completely moved to the spill file
+        if (reader->spillWritten > 0) {
+            if (!writeSpillFile(reader, reader->spillBuffer, reader->spillBuffered))
+                return READ_ERROR;
+            reader->spillEnd = reader->spillBase + reader->spillWritten;
+        }
+        return spilledLength + length;
+    }
+
+    if (*capacity == 0) {
+        //Empty line before anything was allocated
+        if ((*line = malloc(1)) == NULL) {
+            fprintf(stderr, "%s: could not allocate memory for a line\n", programName);
+            return READ_ERROR;
+        }
+        *capacity = 1;
+    }
+    (*line)[length] = '\0';
+    return length;
+}
+
+/**
+ * @brief Checks a given file for palindromes and writes the result in the given output file.
+ * Reads until the end of the file, which also makes it usable for pipes.
  * 
  * @param input The input File from where to read the input values
- * @param caseInsensitive If true, check case insensitive
- * @param ignoreWhitespace  If true, ignores whitespace characters
+ * @param opts The options which control the check
+ * @param arena The scratch arena which is reused for every line
  * @param output The output file to where to write the result
+ * @return true If all lines were processed
+ * @return false If reading, spilling or allocating memory failed
  */
-static void checkFile(FILE *input, bool caseInsensitive, bool ignoreWhitespace, FILE *output) {
+static bool checkFile(FILE *input, options *opts, scratchArena *arena, FILE *output) {
     char *line = NULL;
     size_t len = 0;
     ssize_t read;
+    bool success = true;
+    boundedReader *reader = NULL;
 
-    while ((read = getline(&line, &len, input)) != -1) {
-        if (feof(input) != 0) { //Check for eof
-            break;
+    if (opts->maxLineLength != 0) {
+        if ((reader = calloc(1, sizeof(*reader))) == NULL) {
+            fprintf(stderr, "%s: could not allocate memory for the input buffer\n", programName);
+            return false;
         }
+        reader->fd = fileno(input);
+    }
 
-        removeStringTrailingNewline(line);
+    while (true) {
+        bool spilled = false;
 
-        processValue(line, caseInsensitive, ignoreWhitespace, output);
+        if (reader == NULL) {
+            read = getline(&line, &len, input);
+            if (read == -1) {
+                if (ferror(input)) {
+                    fprintf(stderr, "%s: error while reading input: %s\n", programName, strerror(errno));
+                    success = false;
+                }
+                break;
+            }
+            removeStringTrailingNewline(line);
+        } else {
+            read = readBoundedLine(reader, &line, &len, opts->maxLineLength, &spilled);
+            if (read == READ_ERROR)
+                success = false;
+            if (read < 0)
+                break;
+        }
+
+        if (spilled) {
+            if (!processSpilledValue(reader, read, opts, output))
+                success = false;
+            continue;
+        }
+
+        if (!processValue(line, opts, arena, output))
+            success = false;
     }
 
+    if (reader != NULL) {
+        if (reader->spill != NULL && fclose(reader->spill) == EOF)
+            fprintf(stderr, "%s: could not close the temporary file: %s\n", programName, strerror(errno));
+        free(reader);
+    }
     free(line);
+    return success;
+}
+
+/**
+ * @brief Parses the line length given with -m, the suffixes K, M and G are supported
+ * 
+ * @param value The length to parse
+ * @param length Receives the parsed length
+ * @return true If the length is valid
+ * @return false If the length could not be parsed
+ */
+static bool parseLength(const char *value, size_t *length) {
+    char *endptr = NULL;
+    errno = 0;
+
+    unsigned long long parsed = strtoull(value, &endptr, 10);
+    if (endptr == value || errno == ERANGE || parsed == 0)
+        return false;
+
+    int shift = 0;
+    switch (toupper((unsigned char) *endptr)) {
+        case 'G': shift = 30;
+            endptr++;
+            break;
+        case 'M': shift = 20;
+            endptr++;
+            break;
+        case 'K': shift = 10;
+            endptr++;
+            break;
+    }
+
+    //Reject values which would overflow when the suffix is applied
+    if (*endptr != '\0' || parsed > (SIZE_MAX / 2) >> shift)
+        return false;
+    parsed <<= shift;
+
+    *length = parsed;
+    return true;
 }
 
 int main(int argc, char *argv[]) {
     char *outputFile = NULL;
-    bool caseInsensitive = false;
-    bool ignoreWhitespace = false;
+    options opts = {0};
+    scratchArena arena = {0};
+    bool success = true;
     int c;
 
-    while ( (c = getopt(argc, argv, "sio:")) != -1 ){
+    programName = argv[0];
+
+    opts.whitespaceClasses = WHITESPACE_SPACE;
+
+    while ( (c = getopt(argc, argv, "sicluw:m:o:")) != -1 ){
         switch ( c ) {
-            case 's': ignoreWhitespace = true;
+            case 's': opts.ignoreWhitespace = true;
+                break;
+            case 'i': opts.caseInsensitive = true;
+                break;
+            case 'l': opts.longestSubstring = true;
+                break;
+            case 'c': opts.countSubstrings = true;
+                break;
+            case 'u': opts.utf8 = true;
                 break;
-            case 'i': caseInsensitive = true;
+            case 'w':
+                if (!parseWhitespaceClasses(optarg, &opts.whitespaceClasses)) {
+                    fprintf(stderr, "%s: unknown whitespace class in '%s', use any of s, t, v and u\n", argv[0], optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'm':
+                if (!parseLength(optarg, &opts.maxLineLength)) {
+                    fprintf(stderr, "%s: invalid line length '%s'\n", argv[0], optarg);
+                    return EXIT_FAILURE;
+                }
                 break;
             case 'o': outputFile = optarg;
                 break;
             default:
-                printf("SYNOPSIS:\n     %s [-s] [-i] [-o outfile] [file...]\n", argv[0]);
+                printf("SYNOPSIS:\n     %s [-s] [-i] [-l] [-c] [-u] [-w classes] [-m length] [-o outfile] [file...]\n", argv[0]);
                 return EXIT_FAILURE;
         }
     }
 
+    for (int i = 1; i < 256; i++) {
+        opts.whitespaceBytes[i] = isWhitespace(i, opts.whitespaceClasses & ~WHITESPACE_UNICODE);
+    }
+
     //Initialize output stream
     FILE *output = stdout;
     if (outputFile != NULL) {
@@ -171,19 +1285,21 @@ int main(int argc, char *argv[]) {
             }
 
 
-            checkFile(inputF, caseInsensitive, ignoreWhitespace, output);
+            if (!checkFile(inputF, &opts, &arena, output))
+                success = false;
 
             if (fclose(inputF) == EOF) {
                 fprintf(stderr, "%s:fclose failed of input file %s: %s\n", argv[0], argv[i], strerror(errno));
             }
         }
     } else {
-        //Read from stdin
-        while(true) {
-            checkFile(stdin, caseInsensitive, ignoreWhitespace, output);
-        }
+        //Read from stdin until it is closed
+        if (!checkFile(stdin, &opts, &arena, output))
+            success = false;
     }
 
+    free(arena.memory);
+
     //If we didn't write to stdout, close the new file
     if (outputFile != NULL) {
         if (fclose(output)== EOF) {
@@ -191,7 +1307,7 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    return EXIT_SUCCESS;
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 